@@ -2,6 +2,14 @@
 #include "immintrin.h"
 
 #define N_OF_ITEMS 1048576
+#define N_OF_TRIALS 8
+#define N_OF_FIELDS 9
+#define N_OF_ULP_BUCKETS 33
+#define COMPARE_BLOCK_SIZE 1024
+#define N_OF_PROBE_RUNS 5
+#define PROBE_BYTES_PER_RUN (1024u * 1024u * 1024u)
+#define N_OF_FMA_ITERATIONS (1 << 24)
+#define MAX_PROBE_STREAMS 16
 
 #if defined(__AVX512F__)
 # define BYTE_BOUNDARY 64
@@ -77,12 +85,22 @@ pos_soa Positions2;
 vel_soa Velocities2;
 acc_soa Accelerations2;
 
+// the generated inputs, each kernel starts from a fresh copy of these
+pos_soa InitialPositions;
+vel_soa InitialVelocities;
+acc_soa InitialAccelerations;
+
+// output of the scalar reference kernel, transposed to SoA so it can be compared field by field
+pos_soa ReferencePositions;
+vel_soa ReferenceVelocities;
+acc_soa ReferenceAccelerations;
+
 void
-SingleInstructionSingleData(void)
+SingleInstructionSingleData(u32 N)
 {
     r32 dt = 1.0f / 60.0f;
     r32 dt_per_two = dt / 2.0f;
-    for (u32 i = 0; i < N_OF_ITEMS; ++i)
+    for (u32 i = 0; i < N; ++i)
     {
         velocity PrevVel = Velocities[i];
         r32 DeltaVelX = Accelerations[i].ddx * dt;
@@ -113,7 +131,7 @@ SingleInstructionSingleData(void)
 #endif
 
 void
-SingleInstructionMultipleData(void)
+SingleInstructionMultipleData(u32 N)
 {
 
 IACA_START;
@@ -124,7 +142,7 @@ IACA_START;
     __m512 two = _mm512_set1_ps(2.0f);
     __m512 dt_per_two = _mm512_div_ps(dt, two);
     u32 Stride = BYTE_BOUNDARY / sizeof(r32);
-    u32 Iterations = N_OF_ITEMS - N_OF_ITEMS % Stride;
+    u32 Iterations = N - N % Stride;
     for (u32 i = 0; i < Iterations; i += Stride)
     {
         __m512 PosX_16x = _mm512_load_ps(&Positions2.x[i]);
@@ -172,12 +190,14 @@ IACA_START;
  * 
  * iters(N_OF_ITEMS / 8)     total cycles(iters * sum cycles)
  * 131,072                   16,515,072
+ *
+ * This sums latencies as if nothing overlapped, the measured roofline at the end of main() shows where the kernel actually stands.
  */ 
     __m256 dt = _mm256_set1_ps(1.0f / 60.0f);
     __m256 two = _mm256_set1_ps(2.0f);
     __m256 dt_per_two = _mm256_div_ps(dt, two);
     u32 Stride = BYTE_BOUNDARY / sizeof(r32);
-    u32 Iterations = N_OF_ITEMS - N_OF_ITEMS % Stride;
+    u32 Iterations = N - N % Stride;
     for (u32 i = 0; i < Iterations; i += Stride)
     {
         __m256 PosX_8x = _mm256_load_ps(Positions2.x + i);
@@ -212,7 +232,7 @@ IACA_START;
     __m128 two = _mm_set1_ps(2.0f);
     __m128 dt_per_two = _mm_div_ps(dt, two);
     u32 Stride = BYTE_BOUNDARY / sizeof(r32);
-    u32 Iterations = N_OF_ITEMS - N_OF_ITEMS % Stride;
+    u32 Iterations = N - N % Stride;
     for (u32 i = 0; i < Iterations; i += Stride)
     {
         __m128 PosX_4x = _mm_load_ps(&Positions2.x[i]);
@@ -245,93 +265,857 @@ IACA_START;
 # else
 #  error "instruction set not supported"
 # endif // avx512f, avx, sse
+#else
+    u32 Iterations = 0;
 #endif // fma
 
 IACA_END;
 
+    // the remainder that does not fill a whole register is integrated one lane at a time
+    r32 dt_scalar = 1.0f / 60.0f;
+    r32 dt_per_two_scalar = dt_scalar / 2.0f;
+    for (u32 i = Iterations; i < N; ++i)
+    {
+        r32 PrevVelX = Velocities2.dx[i];
+        r32 PrevVelY = Velocities2.dy[i];
+        r32 PrevVelZ = Velocities2.dz[i];
+        Velocities2.dx[i] += Accelerations2.ddx[i] * dt_scalar;
+        Velocities2.dy[i] += Accelerations2.ddy[i] * dt_scalar;
+        Velocities2.dz[i] += Accelerations2.ddz[i] * dt_scalar;
+        Positions2.x[i] += (Velocities2.dx[i] + PrevVelX) * dt_per_two_scalar;
+        Positions2.y[i] += (Velocities2.dy[i] + PrevVelY) * dt_per_two_scalar;
+        Positions2.z[i] += (Velocities2.dz[i] + PrevVelZ) * dt_per_two_scalar;
+    }
+}
+
+/***
+ * Every kernel that integrates the SoA buffers (Positions2, Velocities2, Accelerations2) registers itself here.
+ * The correctness harness runs each of them against the scalar AoS reference (SingleInstructionSingleData) on the same input.
+ * The roofline report uses the declared memory traffic and FLOPs, these count unique bytes and not load instructions,
+ * e.g. the integrator issues 12 loads but PrevVel reloads Vel, so it reads 9 floats and writes 6 per element,
+ * and 6 FMAs (2 FLOPs each) + 3 adds make 15 FLOPs per element.
+ */
+typedef void (*integrator_kernel)(u32 N);
+
+struct registered_kernel
+{
+    const char *Name;
+    integrator_kernel Kernel;
+    u32 BytesReadPerElement;
+    u32 BytesWrittenPerElement;
+    u32 FlopsPerElement;
+};
+
+registered_kernel Kernels[] =
+{
+    { "Single Instruction Multiple Data", &SingleInstructionMultipleData, 9 * sizeof(r32), 6 * sizeof(r32), 15 },
+};
+
+/***
+ * An absolute epsilon is meaningless for floats: 0.1f is less than one ULP for positions around 100000 and thousands of ULPs for accelerations around 1.
+ * Instead the distance is measured in units in the last place (ULP), that is, how many representable floats lie between the two values.
+ * A mismatch only fails if it exceeds MaxUlp AND its absolute error exceeds AbsFloor. The floor is needed for results near zero:
+ * pos + delta can cancel to a tiny value, where an FMA (single rounding) and a mul + add (two roundings) legitimately differ by thousands of ULPs.
+ */
+struct field_tolerance
+{
+    u32 MaxUlp;
+    r32 AbsFloor;
+};
+
+field_tolerance PositionTolerance = { 2, 1.0e-5f };
+field_tolerance VelocityTolerance = { 2, 1.0e-6f };
+field_tolerance AccelerationTolerance = { 0, 0.0f }; // read only, must come out bit exact
+
+#define NO_INDEX 0xffffffff
+
+struct field_stats
+{
+    u32 MaxUlp;
+    u32 MaxUlpIndex;
+    u64 SumUlp;
+    u32 Mismatches;      // ulp > 0
+    u32 Failures;        // outside of tolerance
+    u32 FirstDivergence; // first index with ulp > 0
+    u32 FirstFailure;    // first index outside of tolerance
+    u32 Histogram[N_OF_ULP_BUCKETS]; // bucket 0 is exact, bucket k holds ulp in [2^(k-1), 2^k)
+};
+
+struct compared_field
+{
+    const char *Name;
+    r32 *Reference;
+    r32 *Actual;
+    field_tolerance Tolerance;
+};
+
+inline void
+ClearStats(field_stats *Stats)
+{
+    memset(Stats, 0, sizeof(*Stats));
+    Stats->MaxUlpIndex = NO_INDEX;
+    Stats->FirstDivergence = NO_INDEX;
+    Stats->FirstFailure = NO_INDEX;
+}
+
+// maps the float bit pattern to an integer that is monotonic with the float value, -0.0f and +0.0f both map to 0
+inline i32
+OrderedBits(r32 X)
+{
+    i32 Bits;
+    memcpy(&Bits, &X, sizeof(Bits));
+    i32 SignMask = Bits >> 31;
+    return ((Bits ^ (SignMask & 0x7fffffff)) - SignMask);
+}
+
+// index of the highest set bit + 1, so 1 -> 1, 2..3 -> 2, 4..7 -> 3, X must not be 0
+inline u32
+UlpBucket(u32 X)
+{
+#if defined(_MSC_VER)
+    unsigned long Index;
+    _BitScanReverse(&Index, X);
+    return (Index + 1);
+#else
+    return (32 - __builtin_clz(X));
+#endif
+}
+
+// X must not be 0
+inline u32
+LowestSetBit(u32 X)
+{
+#if defined(_MSC_VER)
+    unsigned long Index;
+    _BitScanForward(&Index, X);
+    return (Index);
+#else
+    return (__builtin_ctz(X));
+#endif
+}
+
+// the distance of the ordered values, both are within +-(2^31 - 1) so the difference of max and min always fits into u32
+inline u32
+UlpDistance(r32 A, r32 B)
+{
+    i32 OrderedA = OrderedBits(A);
+    i32 OrderedB = OrderedBits(B);
+    return ((u32)max(OrderedA, OrderedB) - (u32)min(OrderedA, OrderedB));
+}
+
+/***
+ * Work is split in two passes per block:
+ * - the ULP distances are computed with intrinsics into a small buffer that stays in L1, along with a bit mask per register of the lanes that mismatch
+ * - only the set bits of those masks are folded into the statistics, exact matches cost nothing beyond the first pass
+ */
+void
+CompareRange(compared_field *Fields, field_stats *Stats, u32 Begin, u32 End)
+{
+    u32 Ulps[COMPARE_BLOCK_SIZE];
+    u32 Masks[COMPARE_BLOCK_SIZE / 4 + 1];
+    for (u32 FieldIndex = 0; FieldIndex < N_OF_FIELDS; ++FieldIndex)
+    {
+        compared_field *Field = &Fields[FieldIndex];
+        field_stats *FieldStats = &Stats[FieldIndex];
+        for (u32 BlockBegin = Begin; BlockBegin < End; BlockBegin += COMPARE_BLOCK_SIZE)
+        {
+            u32 Count = min(End - BlockBegin, (u32)COMPARE_BLOCK_SIZE);
+            r32 *Reference = Field->Reference + BlockBegin;
+            r32 *Actual = Field->Actual + BlockBegin;
+            u32 AnyMismatch = 0;
+
+#if defined(__AVX512F__)
+            u32 Lanes = 16;
+            u32 Iterations = Count - Count % Lanes;
+            // with mask registers the negative lanes become 0x80000000 - Bits, and |a - b| is 0 - (a - b) in the lanes where a < b
+            __m512i SignBit = _mm512_set1_epi32((i32)0x80000000);
+            __m512i Zero = _mm512_setzero_si512();
+            for (u32 i = 0; i < Iterations; i += Lanes)
+            {
+                __m512i RefBits = _mm512_castps_si512(_mm512_loadu_ps(Reference + i));
+                __m512i ActBits = _mm512_castps_si512(_mm512_loadu_ps(Actual + i));
+                __m512i RefOrdered = _mm512_mask_sub_epi32(RefBits, _mm512_cmplt_epi32_mask(RefBits, Zero), SignBit, RefBits);
+                __m512i ActOrdered = _mm512_mask_sub_epi32(ActBits, _mm512_cmplt_epi32_mask(ActBits, Zero), SignBit, ActBits);
+                __m512i Delta = _mm512_sub_epi32(RefOrdered, ActOrdered);
+                __m512i Ulp = _mm512_mask_sub_epi32(Delta, _mm512_cmplt_epi32_mask(RefOrdered, ActOrdered), Zero, Delta);
+                _mm512_storeu_si512(Ulps + i, Ulp);
+                u32 Mask = _mm512_test_epi32_mask(Ulp, Ulp);
+                Masks[i / Lanes] = Mask;
+                AnyMismatch |= Mask;
+            }
+#elif defined(__AVX2__)
+            u32 Lanes = 8;
+            u32 Iterations = Count - Count % Lanes;
+            __m256i Magnitude = _mm256_set1_epi32(0x7fffffff);
+            __m256i Zero = _mm256_setzero_si256();
+            for (u32 i = 0; i < Iterations; i += Lanes)
+            {
+                __m256i RefBits = _mm256_castps_si256(_mm256_loadu_ps(Reference + i));
+                __m256i ActBits = _mm256_castps_si256(_mm256_loadu_ps(Actual + i));
+                __m256i RefSign = _mm256_srai_epi32(RefBits, 31);
+                __m256i ActSign = _mm256_srai_epi32(ActBits, 31);
+                __m256i RefOrdered = _mm256_sub_epi32(_mm256_xor_si256(RefBits, _mm256_and_si256(RefSign, Magnitude)), RefSign);
+                __m256i ActOrdered = _mm256_sub_epi32(_mm256_xor_si256(ActBits, _mm256_and_si256(ActSign, Magnitude)), ActSign);
+                __m256i Ulp = _mm256_sub_epi32(_mm256_max_epi32(RefOrdered, ActOrdered), _mm256_min_epi32(RefOrdered, ActOrdered));
+                _mm256_storeu_si256((__m256i *)(Ulps + i), Ulp);
+                u32 Mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(Ulp, Zero))) & 0xff;
+                Masks[i / Lanes] = Mask;
+                AnyMismatch |= Mask;
+            }
+#elif defined(__SSE__)
+            // SSE2 has no 32 bit max/min, |a - b| is taken as (d ^ m) - m where m is all ones if a < b
+            u32 Lanes = 4;
+            u32 Iterations = Count - Count % Lanes;
+            __m128i Magnitude = _mm_set1_epi32(0x7fffffff);
+            __m128i Zero = _mm_setzero_si128();
+            for (u32 i = 0; i < Iterations; i += Lanes)
+            {
+                __m128i RefBits = _mm_castps_si128(_mm_loadu_ps(Reference + i));
+                __m128i ActBits = _mm_castps_si128(_mm_loadu_ps(Actual + i));
+                __m128i RefSign = _mm_srai_epi32(RefBits, 31);
+                __m128i ActSign = _mm_srai_epi32(ActBits, 31);
+                __m128i RefOrdered = _mm_sub_epi32(_mm_xor_si128(RefBits, _mm_and_si128(RefSign, Magnitude)), RefSign);
+                __m128i ActOrdered = _mm_sub_epi32(_mm_xor_si128(ActBits, _mm_and_si128(ActSign, Magnitude)), ActSign);
+                __m128i Less = _mm_cmplt_epi32(RefOrdered, ActOrdered);
+                __m128i Ulp = _mm_sub_epi32(_mm_xor_si128(_mm_sub_epi32(RefOrdered, ActOrdered), Less), Less);
+                _mm_storeu_si128((__m128i *)(Ulps + i), Ulp);
+                u32 Mask = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(Ulp, Zero))) & 0xf;
+                Masks[i / Lanes] = Mask;
+                AnyMismatch |= Mask;
+            }
+#else
+# error "instruction set not supported"
+#endif
+
+            // the lanes that do not fill a whole register get a mask of their own
+            u32 TailMask = 0;
+            for (u32 i = Iterations; i < Count; ++i)
+            {
+                Ulps[i] = UlpDistance(Reference[i], Actual[i]);
+                TailMask |= (u32)(Ulps[i] != 0) << (i - Iterations);
+            }
+            u32 NumberOfMasks = Iterations / Lanes;
+            if (TailMask)
+            {
+                Masks[NumberOfMasks++] = TailMask;
+                AnyMismatch |= TailMask;
+            }
+
+            u32 BlockMismatches = 0;
+            for (u32 MaskIndex = 0; AnyMismatch && MaskIndex < NumberOfMasks; ++MaskIndex)
+            {
+                for (u32 Mask = Masks[MaskIndex]; Mask; Mask &= Mask - 1)
+                {
+                    u32 i = MaskIndex * Lanes + LowestSetBit(Mask);
+                    u32 Ulp = Ulps[i];
+                    u32 Index = BlockBegin + i;
+                    ++BlockMismatches;
+                    ++FieldStats->Histogram[UlpBucket(Ulp)];
+                    FieldStats->SumUlp += Ulp;
+                    if (FieldStats->FirstDivergence == NO_INDEX)
+                    {
+                        FieldStats->FirstDivergence = Index;
+                    }
+                    if (Ulp > FieldStats->MaxUlp)
+                    {
+                        FieldStats->MaxUlp = Ulp;
+                        FieldStats->MaxUlpIndex = Index;
+                    }
+                    r32 AbsError = Reference[i] - Actual[i];
+                    AbsError = AbsError < 0.0f ? -AbsError : AbsError;
+                    // written negated so NaNs count as failures
+                    if (Ulp > Field->Tolerance.MaxUlp && !(AbsError <= Field->Tolerance.AbsFloor))
+                    {
+                        ++FieldStats->Failures;
+                        if (FieldStats->FirstFailure == NO_INDEX)
+                        {
+                            FieldStats->FirstFailure = Index;
+                        }
+                    }
+                }
+            }
+            FieldStats->Mismatches += BlockMismatches;
+            FieldStats->Histogram[0] += Count - BlockMismatches;
+        }
+    }
+}
+
+// Threads get consecutive ranges, so merging them in order keeps the first indices correct
+void
+MergeStats(field_stats *Into, field_stats *From)
+{
+    if (From->MaxUlp > Into->MaxUlp)
+    {
+        Into->MaxUlp = From->MaxUlp;
+        Into->MaxUlpIndex = From->MaxUlpIndex;
+    }
+    Into->SumUlp += From->SumUlp;
+    Into->Mismatches += From->Mismatches;
+    Into->Failures += From->Failures;
+    if (Into->FirstDivergence == NO_INDEX)
+    {
+        Into->FirstDivergence = From->FirstDivergence;
+    }
+    if (Into->FirstFailure == NO_INDEX)
+    {
+        Into->FirstFailure = From->FirstFailure;
+    }
+    for (u32 Bucket = 0; Bucket < N_OF_ULP_BUCKETS; ++Bucket)
+    {
+        Into->Histogram[Bucket] += From->Histogram[Bucket];
+    }
+}
+
+// the threads write their statistics while they run, padded to whole cache lines so they do not false share (see false_sharing.cpp)
+struct alignas(64) thread_stats
+{
+    field_stats Fields[N_OF_FIELDS];
+};
+
+void
+CompareFields(compared_field *Fields, field_stats *Stats, u32 N)
+{
+    u32 NumberOfThreads = max(thread::hardware_concurrency(), 1u);
+    // keep each range a whole number of blocks, so every block starts on a register boundary
+    u32 RangeSize = (N + NumberOfThreads - 1) / NumberOfThreads;
+    RangeSize = (RangeSize + COMPARE_BLOCK_SIZE - 1) / COMPARE_BLOCK_SIZE * COMPARE_BLOCK_SIZE;
+
+    vector<thread_stats> ThreadStats(NumberOfThreads);
+    vector<thread> Threads;
+    for (u32 ThreadIndex = 0; ThreadIndex < NumberOfThreads; ++ThreadIndex)
+    {
+        field_stats *Partial = ThreadStats[ThreadIndex].Fields;
+        for (u32 FieldIndex = 0; FieldIndex < N_OF_FIELDS; ++FieldIndex)
+        {
+            ClearStats(&Partial[FieldIndex]);
+        }
+        u32 Begin = min(ThreadIndex * RangeSize, N);
+        u32 End = min(Begin + RangeSize, N);
+        if (Begin < End)
+        {
+            Threads.push_back(thread(&CompareRange, Fields, Partial, Begin, End));
+        }
+    }
+    for (thread &Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    for (u32 FieldIndex = 0; FieldIndex < N_OF_FIELDS; ++FieldIndex)
+    {
+        ClearStats(&Stats[FieldIndex]);
+        for (u32 ThreadIndex = 0; ThreadIndex < NumberOfThreads; ++ThreadIndex)
+        {
+            MergeStats(&Stats[FieldIndex], &ThreadStats[ThreadIndex].Fields[FieldIndex]);
+        }
+    }
+}
+
+void
+PrintIndex(const char *Label, u32 Index)
+{
+    cout << Label;
+    if (Index == NO_INDEX)
+    {
+        cout << "-";
+    }
+    else
+    {
+        cout << Index;
+    }
+}
+
+void
+PrintStats(compared_field *Field, field_stats *Stats, u32 N)
+{
+    cout << setw(20) << Field->Name << ": ";
+    cout << "max ulp " << setw(10) << Stats->MaxUlp;
+    PrintIndex(" at ", Stats->MaxUlpIndex);
+    cout << ", mean ulp " << setw(10) << (r64)Stats->SumUlp / N;
+    cout << ", mismatches " << Stats->Mismatches;
+    PrintIndex(", first divergence ", Stats->FirstDivergence);
+    cout << ", failures " << Stats->Failures << " (tolerance " << Field->Tolerance.MaxUlp << " ulp / " << Field->Tolerance.AbsFloor << ")";
+    PrintIndex(", first failure ", Stats->FirstFailure);
+    LOG("");
+    if (Stats->Mismatches)
+    {
+        cout << setw(22) << "histogram:";
+        for (u32 Bucket = 1; Bucket < N_OF_ULP_BUCKETS; ++Bucket)
+        {
+            if (Stats->Histogram[Bucket])
+            {
+                cout << "  [" << (1ull << (Bucket - 1)) << ", " << (1ull << Bucket) << ") " << Stats->Histogram[Bucket];
+            }
+        }
+        LOG("");
+    }
+}
+
+r32 *
+AllocateField(void)
+{
+    return ((r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY));
+}
+
+void
+GenerateData(u32 Seed, u32 N)
+{
+    IsRandomDeviceInitialized = true;
+    rng.seed(Seed);
+    for (u32 i = 0; i < N; ++i)
+    {
+        Positions[i] = { GetRand(-100000.0f, 100000.0f), GetRand(-100000.0f, 100000.0f), GetRand(-100000.0f, 100000.0f) };
+        Velocities[i] = { GetRand(-100.0f, 100.0f), GetRand(-100.0f, 100.0f), GetRand(-100.0f, 100.0f) };
+        Accelerations[i] = { GetRand(-10.0f, 10.0f), GetRand(-10.0f, 10.0f), GetRand(-10.0f, 10.0f) };
+        InitialPositions.x[i] = Positions[i].x;
+        InitialPositions.y[i] = Positions[i].y;
+        InitialPositions.z[i] = Positions[i].z;
+        InitialVelocities.dx[i] = Velocities[i].dx;
+        InitialVelocities.dy[i] = Velocities[i].dy;
+        InitialVelocities.dz[i] = Velocities[i].dz;
+        InitialAccelerations.ddx[i] = Accelerations[i].ddx;
+        InitialAccelerations.ddy[i] = Accelerations[i].ddy;
+        InitialAccelerations.ddz[i] = Accelerations[i].ddz;
+    }
+}
+
+void
+StoreReference(u32 N)
+{
+    for (u32 i = 0; i < N; ++i)
+    {
+        ReferencePositions.x[i] = Positions[i].x;
+        ReferencePositions.y[i] = Positions[i].y;
+        ReferencePositions.z[i] = Positions[i].z;
+        ReferenceVelocities.dx[i] = Velocities[i].dx;
+        ReferenceVelocities.dy[i] = Velocities[i].dy;
+        ReferenceVelocities.dz[i] = Velocities[i].dz;
+        ReferenceAccelerations.ddx[i] = Accelerations[i].ddx;
+        ReferenceAccelerations.ddy[i] = Accelerations[i].ddy;
+        ReferenceAccelerations.ddz[i] = Accelerations[i].ddz;
+    }
+}
+
+void
+LoadInitial(u32 N)
+{
+    memcpy(Positions2.x, InitialPositions.x, N * sizeof(r32));
+    memcpy(Positions2.y, InitialPositions.y, N * sizeof(r32));
+    memcpy(Positions2.z, InitialPositions.z, N * sizeof(r32));
+    memcpy(Velocities2.dx, InitialVelocities.dx, N * sizeof(r32));
+    memcpy(Velocities2.dy, InitialVelocities.dy, N * sizeof(r32));
+    memcpy(Velocities2.dz, InitialVelocities.dz, N * sizeof(r32));
+    memcpy(Accelerations2.ddx, InitialAccelerations.ddx, N * sizeof(r32));
+    memcpy(Accelerations2.ddy, InitialAccelerations.ddy, N * sizeof(r32));
+    memcpy(Accelerations2.ddz, InitialAccelerations.ddz, N * sizeof(r32));
+}
+
+/***
+ * Roofline: a kernel can not go faster than either the FLOP rate of the core or the rate at which the memory level holding its data delivers bytes.
+ * attainable FLOPs/cycle = min(peak FLOPs/cycle, arithmetic intensity (FLOPs/byte) * bytes/cycle of the level)
+ * If the intensity is below the ridge point (peak / bandwidth) the kernel is memory bound and optimizing the arithmetic is pointless.
+ *
+ * Everything is measured on a single thread in rdtsc cycles, as that is what the kernels run on.
+ * Both the probe and the kernels only store into lines they have just loaded, so neither pays an extra read for the write-allocate.
+ */
+struct memory_level
+{
+    const char *Name;
+    u32 WorkingSetBytes; // comfortably fits into the level on typical desktop CPUs, adjust for the machine
+};
+
+memory_level MemoryLevels[] =
+{
+    { "L1", 16 * 1024 },
+    { "L2", 128 * 1024 },
+    { "L3", 4 * 1024 * 1024 },
+    { "DRAM", 256 * 1024 * 1024 },
+};
+
+#define N_OF_MEMORY_LEVELS (sizeof(MemoryLevels) / sizeof(MemoryLevels[0]))
+
+// streams are staggered by a few cache lines, otherwise they all start at the same page offset and fight over the same cache sets
+#define STREAM_STAGGER_BYTES 320
+#define PAGE_BYTES 4096
+
+r32 ProbeSink; // keeps the FMA probe from being optimized away
+
+// the probes are the same for every instruction set, only the register width changes
+#if defined(__AVX512F__)
+typedef __m512 probe_r32;
+# define ProbeSet1(x) _mm512_set1_ps(x)
+# define ProbeLoad(p) _mm512_load_ps(p)
+# define ProbeStore(p, x) _mm512_store_ps(p, x)
+# define ProbeAdd(a, b) _mm512_add_ps(a, b)
+# define ProbeMul(a, b) _mm512_mul_ps(a, b)
+# define ProbeFirst(x) _mm512_cvtss_f32(x)
+# if defined(__FMA__)
+#  define ProbeMulAdd(a, b, c) _mm512_fmadd_ps(a, b, c)
+# endif
+#elif defined(__AVX__)
+typedef __m256 probe_r32;
+# define ProbeSet1(x) _mm256_set1_ps(x)
+# define ProbeLoad(p) _mm256_load_ps(p)
+# define ProbeStore(p, x) _mm256_store_ps(p, x)
+# define ProbeAdd(a, b) _mm256_add_ps(a, b)
+# define ProbeMul(a, b) _mm256_mul_ps(a, b)
+# define ProbeFirst(x) _mm_cvtss_f32(_mm256_castps256_ps128(x))
+# if defined(__FMA__)
+#  define ProbeMulAdd(a, b, c) _mm256_fmadd_ps(a, b, c)
+# endif
+#elif defined(__SSE__)
+typedef __m128 probe_r32;
+# define ProbeSet1(x) _mm_set1_ps(x)
+# define ProbeLoad(p) _mm_load_ps(p)
+# define ProbeStore(p, x) _mm_store_ps(p, x)
+# define ProbeAdd(a, b) _mm_add_ps(a, b)
+# define ProbeMul(a, b) _mm_mul_ps(a, b)
+# define ProbeFirst(x) _mm_cvtss_f32(x)
+# if defined(__FMA__)
+#  define ProbeMulAdd(a, b, c) _mm_fmadd_ps(a, b, c)
+# endif
+#else
+# error "instruction set not supported"
+#endif
+
+// without FMA the peak is measured with a separate multiply and add, which is still 2 FLOPs
+#if !defined(ProbeMulAdd)
+# define ProbeMulAdd(a, b, c) ProbeAdd(ProbeMul(a, b), c)
+#endif
+
+/***
+ * Carves StreamCount arrays of N floats from one allocation, each starting STREAM_STAGGER_BYTES further into its page than the previous one.
+ * Returns the allocation to free.
+ */
+r32 *
+AllocateStreams(r32 **Streams, u32 StreamCount, u32 N)
+{
+    u64 PageAlignedBytes = ((u64)N * sizeof(r32) + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+    u64 Pitch = PageAlignedBytes + STREAM_STAGGER_BYTES;
+    u8 *Memory = (u8 *)_aligned_malloc(Pitch * StreamCount, PAGE_BYTES);
+    for (u32 Stream = 0; Stream < StreamCount; ++Stream)
+    {
+        Streams[Stream] = (r32 *)(Memory + Pitch * Stream);
+    }
+    return ((r32 *)Memory);
 }
 
-inline b32
-Limit(r32 X, r32 Limit, r32 Epsilon)
+/***
+ * STREAM style A = A + B * s, 2 loads and 1 store per element, the store goes to the line that was just loaded like in the kernels.
+ * Unrolled 4 times, out of L1 the loop overhead alone would otherwise be the bottleneck. N has to be a multiple of 4 * Stride.
+ */
+void
+UpdateProbe(r32 *A, r32 *B, u32 N)
 {
-    return (Limit - Epsilon <= X && X <= Limit + Epsilon);
+    u32 Stride = BYTE_BOUNDARY / sizeof(r32);
+    probe_r32 Scale = ProbeSet1(0.000001f);
+    for (u32 i = 0; i < N; i += 4 * Stride)
+    {
+        ProbeStore(A + i, ProbeMulAdd(ProbeLoad(B + i), Scale, ProbeLoad(A + i)));
+        ProbeStore(A + i + Stride, ProbeMulAdd(ProbeLoad(B + i + Stride), Scale, ProbeLoad(A + i + Stride)));
+        ProbeStore(A + i + 2 * Stride, ProbeMulAdd(ProbeLoad(B + i + 2 * Stride), Scale, ProbeLoad(A + i + 2 * Stride)));
+        ProbeStore(A + i + 3 * Stride, ProbeMulAdd(ProbeLoad(B + i + 3 * Stride), Scale, ProbeLoad(A + i + 3 * Stride)));
+    }
+}
+
+// every stream is read and written back in place, S = S * Scale + Offset, 1 load and 1 store per element and stream, unrolled like UpdateProbe
+void
+InPlaceProbe(r32 **Streams, u32 StreamCount, u32 N)
+{
+    u32 Stride = BYTE_BOUNDARY / sizeof(r32);
+    probe_r32 Scale = ProbeSet1(0.999999f);
+    probe_r32 Offset = ProbeSet1(0.000001f);
+    for (u32 i = 0; i < N; i += 4 * Stride)
+    {
+        for (u32 Stream = 0; Stream < StreamCount; ++Stream)
+        {
+            r32 *S = Streams[Stream] + i;
+            ProbeStore(S, ProbeMulAdd(ProbeLoad(S), Scale, Offset));
+            ProbeStore(S + Stride, ProbeMulAdd(ProbeLoad(S + Stride), Scale, Offset));
+            ProbeStore(S + 2 * Stride, ProbeMulAdd(ProbeLoad(S + 2 * Stride), Scale, Offset));
+            ProbeStore(S + 3 * Stride, ProbeMulAdd(ProbeLoad(S + 3 * Stride), Scale, Offset));
+        }
+    }
+}
+
+/***
+ * Returns bytes/cycle of the update probe when StreamCount is 0, otherwise of the in-place probe over StreamCount streams.
+ */
+r64
+MeasureProbe(u32 WorkingSetBytes, u32 StreamCount)
+{
+    u32 Stride = BYTE_BOUNDARY / sizeof(r32);
+    u32 AllocatedStreams = (StreamCount ? StreamCount : 2);
+    u32 N = WorkingSetBytes / (AllocatedStreams * sizeof(r32));
+    N -= N % (4 * Stride);
+    r32 *Streams[MAX_PROBE_STREAMS];
+    r32 *Memory = AllocateStreams(Streams, AllocatedStreams, N);
+    for (u32 Stream = 0; Stream < AllocatedStreams; ++Stream)
+    {
+        for (u32 i = 0; i < N; ++i)
+        {
+            Streams[Stream][i] = GetRand(-1.0f, 1.0f);
+        }
+    }
+
+    u64 BytesPerPass = (u64)N * (StreamCount ? 2 * StreamCount : 3) * sizeof(r32);
+    u32 Passes = (u32)max(PROBE_BYTES_PER_RUN / BytesPerPass, (u64)1);
+    u64 BestCycles = ~0ull;
+    // the first run only warms up the caches and the page tables
+    for (u32 Run = 0; Run <= N_OF_PROBE_RUNS; ++Run)
+    {
+        u64 CyclesStart = __rdtsc();
+        for (u32 Pass = 0; Pass < Passes; ++Pass)
+        {
+            if (StreamCount)
+            {
+                InPlaceProbe(Streams, StreamCount, N);
+            }
+            else
+            {
+                UpdateProbe(Streams[0], Streams[1], N);
+            }
+        }
+        u64 CyclesEnd = __rdtsc();
+        if (Run > 0)
+        {
+            BestCycles = min(BestCycles, CyclesEnd - CyclesStart);
+        }
+    }
+
+    _aligned_free(Memory);
+    return ((r64)BytesPerPass * Passes / BestCycles);
+}
+
+/***
+ * The roof is the best any access pattern achieves. Few streams are fastest out of L1,
+ * while out of L3 and DRAM a single core needs many streams in flight for the prefetchers to keep up.
+ */
+r64
+MeasureBandwidth(u32 WorkingSetBytes)
+{
+    r64 BytesPerCycle = MeasureProbe(WorkingSetBytes, 0);
+    for (u32 StreamCount = 2; StreamCount <= MAX_PROBE_STREAMS; StreamCount *= 2)
+    {
+        BytesPerCycle = max(BytesPerCycle, MeasureProbe(WorkingSetBytes, StreamCount));
+    }
+    return (BytesPerCycle);
+}
+
+/***
+ * The FMA latency is 4-5 cycles and 2 can be issued per cycle, so at least 8-10 independent chains are needed to keep both ports busy.
+ * The accumulators are separate variables on purpose, an array of them is not guaranteed to stay in registers.
+ */
+r64
+MeasurePeakFlops(void)
+{
+    u64 BestCycles = ~0ull;
+    probe_r32 Mul = ProbeSet1(0.999999f);
+    probe_r32 Add = ProbeSet1(0.000001f);
+    for (u32 Run = 0; Run <= N_OF_PROBE_RUNS; ++Run)
+    {
+        probe_r32 Acc0 = ProbeSet1(0.0f);
+        probe_r32 Acc1 = ProbeSet1(1.0f);
+        probe_r32 Acc2 = ProbeSet1(2.0f);
+        probe_r32 Acc3 = ProbeSet1(3.0f);
+        probe_r32 Acc4 = ProbeSet1(4.0f);
+        probe_r32 Acc5 = ProbeSet1(5.0f);
+        probe_r32 Acc6 = ProbeSet1(6.0f);
+        probe_r32 Acc7 = ProbeSet1(7.0f);
+        probe_r32 Acc8 = ProbeSet1(8.0f);
+        probe_r32 Acc9 = ProbeSet1(9.0f);
+        u64 CyclesStart = __rdtsc();
+        for (u32 Iteration = 0; Iteration < N_OF_FMA_ITERATIONS; ++Iteration)
+        {
+            Acc0 = ProbeMulAdd(Acc0, Mul, Add);
+            Acc1 = ProbeMulAdd(Acc1, Mul, Add);
+            Acc2 = ProbeMulAdd(Acc2, Mul, Add);
+            Acc3 = ProbeMulAdd(Acc3, Mul, Add);
+            Acc4 = ProbeMulAdd(Acc4, Mul, Add);
+            Acc5 = ProbeMulAdd(Acc5, Mul, Add);
+            Acc6 = ProbeMulAdd(Acc6, Mul, Add);
+            Acc7 = ProbeMulAdd(Acc7, Mul, Add);
+            Acc8 = ProbeMulAdd(Acc8, Mul, Add);
+            Acc9 = ProbeMulAdd(Acc9, Mul, Add);
+        }
+        u64 CyclesEnd = __rdtsc();
+        ProbeSink += ProbeFirst(Acc0) + ProbeFirst(Acc1) + ProbeFirst(Acc2) + ProbeFirst(Acc3) + ProbeFirst(Acc4) +
+                     ProbeFirst(Acc5) + ProbeFirst(Acc6) + ProbeFirst(Acc7) + ProbeFirst(Acc8) + ProbeFirst(Acc9);
+        if (Run > 0)
+        {
+            BestCycles = min(BestCycles, CyclesEnd - CyclesStart);
+        }
+    }
+
+    u32 Lanes = BYTE_BOUNDARY / sizeof(r32);
+    return ((r64)N_OF_FMA_ITERATIONS * 10 * Lanes * 2 / BestCycles);
+}
+
+void
+RooflineReport(void)
+{
+    LOG("");
+    LOG("Roofline, per rdtsc cycle on a single thread");
+    r64 PeakFlops = MeasurePeakFlops();
+    LOG(setw(40) << "Peak FLOPs/cycle: " << PeakFlops);
+    r64 LevelBytesPerCycle[N_OF_MEMORY_LEVELS];
+    for (u32 LevelIndex = 0; LevelIndex < N_OF_MEMORY_LEVELS; ++LevelIndex)
+    {
+        memory_level &Level = MemoryLevels[LevelIndex];
+        LevelBytesPerCycle[LevelIndex] = MeasureBandwidth(Level.WorkingSetBytes);
+        LOG(setw(34) << Level.Name << " bytes/cycle: " << setw(10) << LevelBytesPerCycle[LevelIndex]
+            << " (working set " << Level.WorkingSetBytes / 1024 << "K, ridge point " << PeakFlops / LevelBytesPerCycle[LevelIndex] << " FLOPs/byte)");
+    }
+
+    // the kernels work on the SoA globals, these are pointed at buffers sized for each level and restored at the end
+    pos_soa SavedPositions = Positions2;
+    vel_soa SavedVelocities = Velocities2;
+    acc_soa SavedAccelerations = Accelerations2;
+    u32 Stride = BYTE_BOUNDARY / sizeof(r32);
+    for (registered_kernel &Kernel : Kernels)
+    {
+        u32 BytesPerElement = Kernel.BytesReadPerElement + Kernel.BytesWrittenPerElement;
+        r64 Intensity = (r64)Kernel.FlopsPerElement / BytesPerElement;
+        LOG("");
+        LOG(Kernel.Name << ", " << Intensity << " FLOPs/byte");
+        for (u32 LevelIndex = 0; LevelIndex < N_OF_MEMORY_LEVELS; ++LevelIndex)
+        {
+            memory_level &Level = MemoryLevels[LevelIndex];
+            u32 N = Level.WorkingSetBytes / Kernel.BytesReadPerElement;
+            N -= N % Stride;
+            r32 *Streams[N_OF_FIELDS];
+            r32 *Memory = AllocateStreams(Streams, N_OF_FIELDS, N);
+            Positions2 = { Streams[0], Streams[1], Streams[2] };
+            Velocities2 = { Streams[3], Streams[4], Streams[5] };
+            Accelerations2 = { Streams[6], Streams[7], Streams[8] };
+            for (u32 i = 0; i < N; ++i)
+            {
+                Positions2.x[i] = GetRand(-100000.0f, 100000.0f);
+                Positions2.y[i] = GetRand(-100000.0f, 100000.0f);
+                Positions2.z[i] = GetRand(-100000.0f, 100000.0f);
+                Velocities2.dx[i] = GetRand(-100.0f, 100.0f);
+                Velocities2.dy[i] = GetRand(-100.0f, 100.0f);
+                Velocities2.dz[i] = GetRand(-100.0f, 100.0f);
+                Accelerations2.ddx[i] = GetRand(-10.0f, 10.0f);
+                Accelerations2.ddy[i] = GetRand(-10.0f, 10.0f);
+                Accelerations2.ddz[i] = GetRand(-10.0f, 10.0f);
+            }
+
+            u32 Passes = (u32)max(PROBE_BYTES_PER_RUN / ((u64)N * BytesPerElement), (u64)1);
+            u64 BestCycles = ~0ull;
+            for (u32 Run = 0; Run <= N_OF_PROBE_RUNS; ++Run)
+            {
+                u64 CyclesStart = __rdtsc();
+                for (u32 Pass = 0; Pass < Passes; ++Pass)
+                {
+                    Kernel.Kernel(N);
+                }
+                u64 CyclesEnd = __rdtsc();
+                if (Run > 0)
+                {
+                    BestCycles = min(BestCycles, CyclesEnd - CyclesStart);
+                }
+            }
+
+            r64 Elements = (r64)N * Passes;
+            r64 BytesPerCycle = Elements * BytesPerElement / BestCycles;
+            r64 FlopsPerCycle = Elements * Kernel.FlopsPerElement / BestCycles;
+            _aligned_free(Memory);
+
+            r64 MemoryRoof = Intensity * LevelBytesPerCycle[LevelIndex];
+            r64 Attainable = min(PeakFlops, MemoryRoof);
+            LOG(setw(10) << Level.Name << " (working set " << setw(6) << (u64)N * Kernel.BytesReadPerElement / 1024 << "K): "
+                << setw(10) << BytesPerCycle << " bytes/cycle, "
+                << setw(10) << FlopsPerCycle << " FLOPs/cycle, attainable " << setw(10) << Attainable << ", "
+                << setw(6) << 100.0 * FlopsPerCycle / Attainable << "%, "
+                << (MemoryRoof < PeakFlops ? "memory bound" : "compute bound"));
+        }
+    }
+
+    Positions2 = SavedPositions;
+    Velocities2 = SavedVelocities;
+    Accelerations2 = SavedAccelerations;
 }
 
 int main()
 {
-    Positions.reserve(N_OF_ITEMS);
-    Velocities.reserve(N_OF_ITEMS);
-    Accelerations.reserve(N_OF_ITEMS);
-
-    Positions2.x = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Positions2.y = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Positions2.z = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Velocities2.dx = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Velocities2.dy = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Velocities2.dz = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Accelerations2.ddx = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Accelerations2.ddy = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-    Accelerations2.ddz = (r32 *)_aligned_malloc(N_OF_ITEMS * sizeof(r32), BYTE_BOUNDARY);
-
-    for (u32 i = 0; i < N_OF_ITEMS; ++i)
-    {
-        Positions.push_back({ GetRand(-100000.0f, 100000.0f), GetRand(-100000.0f, 100000.0f), GetRand(-100000.0f, 100000.0f) });
-        Velocities.push_back({ GetRand(-100.0f, 100.0f), GetRand(-100.0f, 100.0f), GetRand(-100.0f, 100.0f) });
-        Accelerations.push_back({ GetRand(-10.0f, 10.0f), GetRand(-10.0f, 10.0f), GetRand(-10.0f, 10.0f) });
-        Positions2.x[i] = Positions[i].x;
-        Positions2.y[i] = Positions[i].y;
-        Positions2.z[i] = Positions[i].z;
-        Velocities2.dx[i] = Velocities[i].dx;
-        Velocities2.dy[i] = Velocities[i].dy;
-        Velocities2.dz[i] = Velocities[i].dz;
-        Accelerations2.ddx[i] = Accelerations[i].ddx;
-        Accelerations2.ddy[i] = Accelerations[i].ddy;
-        Accelerations2.ddz[i] = Accelerations[i].ddz;
-    }
-
-    u64 CyclesStart = __rdtsc();
-    SingleInstructionSingleData();
-    u64 CyclesEnd = __rdtsc();
-    LOG(setw(40 + strlen("Clock cycles")) << "Clock cycles");
-    LOG(setw(40) << "Single Instruction Single Data: " << (CyclesEnd - CyclesStart) / 1000000.0f << "M");
-
-    CyclesStart = __rdtsc();
-    SingleInstructionMultipleData();
-    CyclesEnd = __rdtsc();
-    LOG(setw(40) << "Single Instruction Multiple Data: " << (CyclesEnd - CyclesStart) / 1000000.0f << "M");
-
-    r32 Epsilon = 0.1f;
-    for (u32 Index = 0;
-         Index < N_OF_ITEMS;
-         ++Index)
-    {
-        b32 Result =
-            (Limit(Positions[Index].x, Positions2.x[Index], Epsilon) && Limit(Positions[Index].y, Positions2.y[Index], Epsilon) && Limit(Positions[Index].z, Positions2.z[Index], Epsilon) &&
-             Limit(Velocities[Index].dx, Velocities2.dx[Index], Epsilon) && Limit(Velocities[Index].dy, Velocities2.dy[Index], Epsilon) && Limit(Velocities[Index].dz, Velocities2.dz[Index], Epsilon) &&
-             Limit(Accelerations[Index].ddx, Accelerations2.ddx[Index], Epsilon) && Limit(Accelerations[Index].ddy, Accelerations2.ddy[Index], Epsilon) && Limit(Accelerations[Index].ddz, Accelerations2.ddz[Index], Epsilon));
-        if (Result == false)
+    Positions.resize(N_OF_ITEMS);
+    Velocities.resize(N_OF_ITEMS);
+    Accelerations.resize(N_OF_ITEMS);
+
+    Positions2 = { AllocateField(), AllocateField(), AllocateField() };
+    Velocities2 = { AllocateField(), AllocateField(), AllocateField() };
+    Accelerations2 = { AllocateField(), AllocateField(), AllocateField() };
+    InitialPositions = { AllocateField(), AllocateField(), AllocateField() };
+    InitialVelocities = { AllocateField(), AllocateField(), AllocateField() };
+    InitialAccelerations = { AllocateField(), AllocateField(), AllocateField() };
+    ReferencePositions = { AllocateField(), AllocateField(), AllocateField() };
+    ReferenceVelocities = { AllocateField(), AllocateField(), AllocateField() };
+    ReferenceAccelerations = { AllocateField(), AllocateField(), AllocateField() };
+
+    compared_field Fields[N_OF_FIELDS] =
+    {
+        { "Positions.x", ReferencePositions.x, Positions2.x, PositionTolerance },
+        { "Positions.y", ReferencePositions.y, Positions2.y, PositionTolerance },
+        { "Positions.z", ReferencePositions.z, Positions2.z, PositionTolerance },
+        { "Velocities.dx", ReferenceVelocities.dx, Velocities2.dx, VelocityTolerance },
+        { "Velocities.dy", ReferenceVelocities.dy, Velocities2.dy, VelocityTolerance },
+        { "Velocities.dz", ReferenceVelocities.dz, Velocities2.dz, VelocityTolerance },
+        { "Accelerations.ddx", ReferenceAccelerations.ddx, Accelerations2.ddx, AccelerationTolerance },
+        { "Accelerations.ddy", ReferenceAccelerations.ddy, Accelerations2.ddy, AccelerationTolerance },
+        { "Accelerations.ddz", ReferenceAccelerations.ddz, Accelerations2.ddz, AccelerationTolerance },
+    };
+    field_stats Stats[N_OF_FIELDS];
+
+    // the first trial is the full sized benchmark, the rest use random sizes to also exercise the remainder loops
+    mt19937 TrialRng(42);
+    uniform_int_distribution<u32> TrialSize(1, N_OF_ITEMS);
+    u32 FailedComparisons = 0;
+    for (u32 Trial = 0; Trial < N_OF_TRIALS; ++Trial)
+    {
+        u32 Seed = TrialRng();
+        u32 N = (Trial == 0 ? N_OF_ITEMS : TrialSize(TrialRng));
+        GenerateData(Seed, N);
+        LOG("");
+        LOG("Trial " << Trial << ", seed " << Seed << ", N " << N);
+
+        u64 CyclesStart = __rdtsc();
+        SingleInstructionSingleData(N);
+        u64 CyclesEnd = __rdtsc();
+        StoreReference(N);
+        LOG(setw(40 + strlen("Clock cycles")) << "Clock cycles");
+        LOG(setw(40) << "Single Instruction Single Data: " << (CyclesEnd - CyclesStart) / 1000000.0f << "M");
+
+        for (registered_kernel &Kernel : Kernels)
         {
-            LOG(Positions[Index].x);
-            LOG(Positions2.x[Index]);
-            LOG(Positions[Index].y);
-            LOG(Positions2.y[Index]);
-            LOG(Positions[Index].z);
-            LOG(Positions2.z[Index]);
-            LOG(Velocities[Index].dx);
-            LOG(Velocities2.dx[Index]);
-            LOG(Velocities[Index].dy);
-            LOG(Velocities2.dy[Index]);
-            LOG(Velocities[Index].dz);
-            LOG(Velocities2.dz[Index]);
-            LOG(Accelerations[Index].ddx);
-            LOG(Accelerations2.ddx[Index]);
-            LOG(Accelerations[Index].ddy);
-            LOG(Accelerations2.ddy[Index]);
-            LOG(Accelerations[Index].ddz);
-            LOG(Accelerations2.ddz[Index]);
-            LOG("Failure, the two data sets are not equal..");
-            exit(1);
+            LoadInitial(N);
+            CyclesStart = __rdtsc();
+            Kernel.Kernel(N);
+            CyclesEnd = __rdtsc();
+            LOG(setw(38) << Kernel.Name << ": " << (CyclesEnd - CyclesStart) / 1000000.0f << "M");
+
+            CompareFields(Fields, Stats, N);
+            b32 Failed = false;
+            for (u32 FieldIndex = 0; FieldIndex < N_OF_FIELDS; ++FieldIndex)
+            {
+                PrintStats(&Fields[FieldIndex], &Stats[FieldIndex], N);
+                Failed |= (Stats[FieldIndex].Failures != 0);
+            }
+            if (Failed)
+            {
+                LOG("Failure, " << Kernel.Name << " is outside of tolerance");
+                ++FailedComparisons;
+            }
         }
     }
-    LOG("Success, the two data sets are equal!");
+
+    LOG("");
+    if (FailedComparisons)
+    {
+        LOG("Failure, " << FailedComparisons << " kernel runs are not equal to the reference..");
+        exit(1);
+    }
+    LOG("Success, all kernels are equal to the reference within tolerance!");
+
+    RooflineReport();
 }